@@ -3,11 +3,12 @@
 #include <numeric>
 #include <chrono>
 #include <cassert>
+#include "memory_tracker.hpp"
 
 // 模拟 shape: (batch, heads, seq_len, head_dim)
 struct KVCache {
-    std::vector<float> k;
-    std::vector<float> v;
+    tracked_vector<float, MemCategory::KVCache> k;  // 分配走记账，扩容时的新旧两份都算进峰值
+    tracked_vector<float, MemCategory::KVCache> v;
     int batch_size;
     int num_heads;
     int seq_len;
@@ -72,5 +73,8 @@ int main() {
     std::cout << "最终内存占用: " << cache.memory_mb() << " MB" << std::endl;
     std::cout << "Seq Length: " << cache.seq_len << std::endl;
     
+    // memory_mb() 只按元素数算，记账里是实际申请的容量和扩容峰值
+    MemoryTracker::instance().dump();
+    
     return 0;
 }
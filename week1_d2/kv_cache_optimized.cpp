@@ -1,7 +1,9 @@
 #include <iostream>
-#include <vectorr>
+#include <vector>
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include "memory_tracker.hpp"
 
 
 struct KVCacheOptimized {
@@ -12,17 +14,17 @@ struct KVCacheOptimized {
 	int current_seq_len;
 	int hidden_dim;   // heads * head_dim
 
-	KVCacheOptimized( int max_len, int dim ) : max_seq_len(max_len), hidden_dim(dim), current_seq_len(0) {
+	KVCacheOptimized( int max_len, int dim ) : max_seq_len(max_len), current_seq_len(0), hidden_dim(dim) {
 		// 1.预分配，一次申请够，避免运行中 realloc
-		k_buffer = new float[ max_seq_len * hidden_dim ];
-		v_buffer = new float[ max_seq_len * hidden_dim ];
+		k_buffer = tracked_new<float>(MemCategory::KVCache, (size_t)max_seq_len * hidden_dim);
+		v_buffer = tracked_new<float>(MemCategory::KVCache, (size_t)max_seq_len * hidden_dim);
 		
-		std::cout << "[系统]预分配现存： "<<( max_seq_len * hidden_dim * 2 * 4 ) / 1024.0 / 1024.0 << " MB " <<std::endl;
+		std::cout << "[系统]预分配现存： " << MemoryTracker::instance().current_bytes(MemCategory::KVCache) / 1024.0 / 1024.0 << " MB " <<std::endl;
 	}
 
 	~KVCacheOptimized() {
-		delete[] k_buffer;
-		delete[] v_buffer;
+		tracked_delete(MemCategory::KVCache, k_buffer, (size_t)max_seq_len * hidden_dim);
+		tracked_delete(MemCategory::KVCache, v_buffer, (size_t)max_seq_len * hidden_dim);
 	}
 
 
@@ -45,14 +47,20 @@ struct KVCacheOptimized {
 				 dummy_sum += k_buffer[i]; // 强制 CPU 读内存
 			}
 	}
-}
+
+	// 投机解码回滚：只把游标退回 new_len，预分配的缓冲区原样保留，之后的写入直接覆盖
+	void truncate(int new_len) {
+		new_len = std::max(0, new_len);
+		if (new_len < current_seq_len) current_seq_len = new_len;
+	}
+};
 
 
 // 模拟生成 1 个 Token 的 K/V
 void generate_token(KVCacheOptimized& cache, int token_id) {
     // 模拟计算：随机生成新 K/V
-    std::vector<float> new_k(hidden_dim);
-    std::vector<float> new_v(hidden_dim);
+    std::vector<float> new_k(cache.hidden_dim);
+    std::vector<float> new_v(cache.hidden_dim);
     
     // 填充数据（实际是用矩阵乘法计算）
     std::fill(new_k.begin(), new_k.end(), token_id * 0.01f);
@@ -73,14 +81,27 @@ int main() {
     
     for (int i = 0; i < 100; ++i) {
         generate_token(cache, i);
-        
+    }
     
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     
     std::cout << "\n✅ 生成 100 个 Token 完成！" << std::endl;
     std::cout << "总耗时: " << duration.count() << " ms" << std::endl;
-    std::cout << "Seq Length: " << cache.seq_len << std::endl;
+    std::cout << "Seq Length: " << cache.current_seq_len << std::endl;
+    
+    // 模拟投机解码拒绝最后 4 个草稿 Token，再重新生成 2 个
+    cache.truncate(cache.current_seq_len - 4);
+    std::cout << "回滚后 Seq Length: " << cache.current_seq_len << std::endl;
+    generate_token(cache, 100);
+    generate_token(cache, 101);
+    std::cout << "重新生成后 Seq Length: " << cache.current_seq_len << std::endl;
+    
+    // 越界的回滚长度按 0 处理，不会让游标变成负数
+    cache.truncate(-1);
+    std::cout << "truncate(-1) 后 Seq Length: " << cache.current_seq_len << std::endl;
+    
+    MemoryTracker::instance().dump();
     
     return 0;
 }
\ No newline at end of file
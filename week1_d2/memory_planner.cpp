@@ -0,0 +1,307 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include "memory_tracker.hpp"
+#include "real_kv_cache.hpp"
+
+// 容量规划 + 记账验证
+// 1. 规划器根据模型配置 / dtype / 上下文长度，算出显存预算内能同时跑几条序列
+// 2. 按规划结果真实分配，用 memory_tracker.hpp 的统计值检查是否超预算
+
+// ================= 被记账的组件 =================
+// 预分配 KV Cache（同 kv_cache_optimized.cpp，只是分配走记账）
+struct KVCacheOptimized {
+    float* k_buffer;
+    float* v_buffer;
+    int max_seq_len;
+    int current_seq_len;
+    int hidden_dim;
+
+    KVCacheOptimized(int max_len, int dim) : max_seq_len(max_len), current_seq_len(0), hidden_dim(dim) {
+        k_buffer = tracked_new<float>(MemCategory::KVCache, (size_t)max_seq_len * hidden_dim);
+        v_buffer = tracked_new<float>(MemCategory::KVCache, (size_t)max_seq_len * hidden_dim);
+    }
+
+    ~KVCacheOptimized() {
+        tracked_delete(MemCategory::KVCache, k_buffer, (size_t)max_seq_len * hidden_dim);
+        tracked_delete(MemCategory::KVCache, v_buffer, (size_t)max_seq_len * hidden_dim);
+    }
+
+    KVCacheOptimized(const KVCacheOptimized&) = delete;
+    KVCacheOptimized& operator=(const KVCacheOptimized&) = delete;
+};
+
+// ================= 容量规划 =================
+enum class DType { FP32, FP16, INT4 };
+
+// INT4 按 32 个一组、每组一个 FP16 scale 计
+double bytes_per_elem(DType t) {
+    switch (t) {
+        case DType::FP32: return 4.0;
+        case DType::FP16: return 2.0;
+        case DType::INT4: return 0.5 + 2.0 / 32;
+    }
+    return 4.0;
+}
+
+const char* dtype_name(DType t) {
+    switch (t) {
+        case DType::FP32: return "fp32";
+        case DType::FP16: return "fp16";
+        case DType::INT4: return "int4";
+    }
+    return "?";
+}
+
+struct ModelConfig {
+    std::string name;
+    int num_layers;
+    int hidden_dim;
+    int num_heads;
+    int num_kv_heads;      // GQA 时小于 num_heads
+    int intermediate_dim;
+    int vocab_size;
+    int mlp_matrices = 2;  // OPT: fc1/fc2 = 2；Llama SwiGLU: gate/up/down = 3
+
+    int head_dim() const { return hidden_dim / num_heads; }
+
+    size_t num_params() const {
+        size_t kv_dim = (size_t)num_kv_heads * head_dim();
+        size_t attn = (size_t)hidden_dim * hidden_dim * 2 + (size_t)hidden_dim * kv_dim * 2;  // Q/O + K/V
+        size_t mlp = (size_t)hidden_dim * intermediate_dim * mlp_matrices;
+        size_t embed = (size_t)vocab_size * hidden_dim * 2;  // Embedding + LM Head
+        return num_layers * (attn + mlp) + embed;
+    }
+};
+
+struct PlanInput {
+    ModelConfig model;
+    DType weight_dtype;
+    DType kv_dtype;
+    int context_len;
+    size_t budget_bytes;
+    int kv_block_tokens = 16;          // KV 按块分配（vLLM 风格），不足一块也占一块
+    size_t fixed_overhead_bytes = 0;   // 运行时 / CUDA context / 碎片预留
+    size_t arena_bytes = 0;            // 每进程一份的 Arena（临时张量池），不随序列数增长
+};
+
+struct PlanResult {
+    size_t weight_bytes;
+    size_t kv_bytes_per_seq;
+    size_t scratch_bytes_per_seq;
+    size_t free_bytes;
+    int max_concurrent_seqs;
+};
+
+// 单条序列 Decode 的临时激活：hidden 的几份拷贝 + Q/K/V + MLP 中间层 + logits，按 FP32 计
+size_t scratch_bytes_per_seq(const ModelConfig& m) {
+    size_t kv_dim = (size_t)m.num_kv_heads * m.head_dim();
+    size_t floats = (size_t)m.hidden_dim * 4 + kv_dim * 2 + (size_t)m.intermediate_dim * 2 + m.vocab_size;
+    return floats * sizeof(float);
+}
+
+size_t kv_bytes_per_token(const ModelConfig& m, DType kv_dtype) {
+    size_t kv_dim = (size_t)m.num_kv_heads * m.head_dim();
+    return (size_t)(2 * m.num_layers * kv_dim * bytes_per_elem(kv_dtype));  // K + V
+}
+
+PlanResult plan_capacity(const PlanInput& in) {
+    PlanResult r{};
+    r.weight_bytes = (size_t)(in.model.num_params() * bytes_per_elem(in.weight_dtype));
+
+    int blocks = (in.context_len + in.kv_block_tokens - 1) / in.kv_block_tokens;
+    r.kv_bytes_per_seq = (size_t)blocks * in.kv_block_tokens * kv_bytes_per_token(in.model, in.kv_dtype);
+    r.scratch_bytes_per_seq = scratch_bytes_per_seq(in.model);
+
+    size_t used = r.weight_bytes + in.fixed_overhead_bytes + in.arena_bytes;
+    r.free_bytes = in.budget_bytes > used ? in.budget_bytes - used : 0;
+    r.max_concurrent_seqs = (int)(r.free_bytes / (r.kv_bytes_per_seq + r.scratch_bytes_per_seq));
+    return r;
+}
+
+void print_plan(const PlanInput& in, const PlanResult& r) {
+    const double GB = 1024.0 * 1024.0 * 1024.0;
+    std::cout << std::fixed << std::setprecision(2)
+              << in.model.name << " | 权重 " << dtype_name(in.weight_dtype)
+              << " | KV " << dtype_name(in.kv_dtype) << " | ctx " << in.context_len
+              << " | 预算 " << in.budget_bytes / GB << " GB" << std::endl;
+    std::cout << "  参数量: " << in.model.num_params() / 1e9 << " B"
+              << " | 权重: " << r.weight_bytes / GB << " GB"
+              << " | 每序列 KV: " << r.kv_bytes_per_seq / 1024.0 / 1024.0 << " MB"
+              << " | 每序列激活: " << r.scratch_bytes_per_seq / 1024.0 / 1024.0 << " MB"
+              << " | Arena: " << in.arena_bytes / 1024.0 / 1024.0 << " MB" << std::endl;
+    std::cout << "  => 最大并发序列数: " << r.max_concurrent_seqs << std::endl;
+}
+
+// ================= 记账验证 =================
+// 小模型的真实权重：按张量形状逐个申请，不经过 num_params()，规划公式漏算的矩阵会在这里暴露
+struct TinyWeights {
+    std::vector<tracked_vector<float, MemCategory::WeightsFP32>> fp32;
+    std::vector<tracked_vector<uint16_t, MemCategory::WeightsFP16>> fp16;
+    std::vector<tracked_vector<uint8_t, MemCategory::WeightsINT4>> int4;  // 打包数据和 FP16 scale 各一块
+
+    // 申请一个 (rows, cols) 的权重张量
+    void add(size_t rows, size_t cols, DType t) {
+        size_t n = rows * cols;
+        switch (t) {
+            case DType::FP32: fp32.emplace_back(n); break;
+            case DType::FP16: fp16.emplace_back(n); break;
+            case DType::INT4:
+                int4.emplace_back((n + 1) / 2);           // 两个 INT4 打包进一个字节
+                int4.emplace_back((n + 31) / 32 * 2);     // 每 32 个一组，一个 FP16 scale
+                break;
+        }
+    }
+};
+
+MemCategory weight_category(DType t) {
+    switch (t) {
+        case DType::FP32: return MemCategory::WeightsFP32;
+        case DType::FP16: return MemCategory::WeightsFP16;
+        case DType::INT4: return MemCategory::WeightsINT4;
+    }
+    return MemCategory::WeightsFP32;
+}
+
+void load_tiny_weights(TinyWeights& w, const ModelConfig& m, DType t) {
+    size_t h = m.hidden_dim, kv = (size_t)m.num_kv_heads * m.head_dim(), inter = m.intermediate_dim;
+    w.add(m.vocab_size, h, t);                     // embed_tokens
+    for (int l = 0; l < m.num_layers; ++l) {
+        w.add(h, h, t);                            // q_proj
+        w.add(h, kv, t);                           // k_proj
+        w.add(h, kv, t);                           // v_proj
+        w.add(h, h, t);                            // o_proj
+        if (m.mlp_matrices == 3) {
+            w.add(h, inter, t);                    // gate_proj
+            w.add(h, inter, t);                    // up_proj
+            w.add(inter, h, t);                    // down_proj
+        } else {
+            w.add(h, inter, t);                    // fc1
+            w.add(inter, h, t);                    // fc2
+        }
+    }
+    w.add(h, m.vocab_size, t);                     // lm_head
+}
+
+// 单条序列的 Decode 临时张量，同样逐个申请
+using Activation = tracked_vector<float, MemCategory::Activations>;
+void alloc_decode_scratch(std::vector<Activation>& acts, const ModelConfig& m) {
+    size_t h = m.hidden_dim, kv = (size_t)m.num_kv_heads * m.head_dim();
+    for (int i = 0; i < 4; ++i) acts.emplace_back(h);  // residual / norm 输出 / q / attn 输出
+    acts.emplace_back(kv);                             // k
+    acts.emplace_back(kv);                             // v
+    acts.emplace_back(m.intermediate_dim);             // MLP 中间层（gate 或 fc1）
+    acts.emplace_back(m.intermediate_dim);             // MLP 中间层（up 或激活后）
+    acts.emplace_back(m.vocab_size);                   // logits
+}
+
+// 按规划结果真实分配，用记账总量对比预算：
+// 1. 实际权重字节数 == 规划的 weight_bytes
+// 2. 规划的 N 条序列，当前值和峰值都不超预算
+// 3. 再多 1 条必须超预算，否则规划偏保守
+bool verify_plan(const PlanInput& in) {
+    const double MB = 1024.0 * 1024.0;
+    const ModelConfig& m = in.model;
+    PlanResult plan = plan_capacity(in);
+    print_plan(in, plan);
+
+    MemoryTracker& tracker = MemoryTracker::instance();
+    tracker.reset_peak();
+    size_t base = tracker.total_current.load();
+    bool ok = true;
+    {
+        TinyWeights weights;
+        load_tiny_weights(weights, m, in.weight_dtype);
+        size_t weight_bytes = tracker.current_bytes(weight_category(in.weight_dtype));
+        bool weights_match = weight_bytes == plan.weight_bytes;
+        std::cout << "权重 实际: " << weight_bytes / MB << " MB | 规划: " << plan.weight_bytes / MB << " MB "
+                  << (weights_match ? "✅" : "❌") << std::endl;
+
+        Arena arena(in.arena_bytes);
+
+        // 每条序列：每层一个预分配 KV Cache（按块向上取整）+ 一份 Decode 临时激活
+        int padded_len = (in.context_len + in.kv_block_tokens - 1) / in.kv_block_tokens * in.kv_block_tokens;
+        int kv_dim = m.num_kv_heads * m.head_dim();
+        std::vector<KVCacheOptimized*> caches;
+        std::vector<Activation> scratch;
+        auto add_sequence = [&] {
+            for (int l = 0; l < m.num_layers; ++l) caches.push_back(new KVCacheOptimized(padded_len, kv_dim));
+            alloc_decode_scratch(scratch, m);
+        };
+        for (int s = 0; s < plan.max_concurrent_seqs; ++s) add_sequence();
+
+        // 一次前向的临时张量从 Arena 里切
+        for (int step = 0; step < 10; ++step) {
+            arena.alloc_floats(m.hidden_dim);
+            arena.alloc_floats(m.intermediate_dim);
+            arena.alloc_floats(m.vocab_size);
+            arena.reset();
+        }
+
+        tracker.dump();
+        size_t current = tracker.total_current.load() - base;
+        size_t peak = tracker.total_peak.load() - base;
+        std::cout << "预算: " << in.budget_bytes / MB << " MB | " << plan.max_concurrent_seqs
+                  << " 条序列 当前: " << current / MB << " MB | 峰值: " << peak / MB << " MB" << std::endl;
+        bool fits = current <= in.budget_bytes && peak <= in.budget_bytes;
+        std::cout << (fits ? "✅ 规划容量内未超预算" : "❌ 规划容量内已超预算") << std::endl;
+
+        add_sequence();
+        current = tracker.total_current.load() - base;
+        std::cout << plan.max_concurrent_seqs + 1 << " 条序列 当前: " << current / MB << " MB" << std::endl;
+        bool tight = current > in.budget_bytes;
+        std::cout << (tight ? "✅ 多 1 条即超预算，规划已到上限" : "❌ 多 1 条仍未超预算，规划偏保守") << std::endl;
+        ok = weights_match && fits && tight;
+
+        for (auto* c : caches) delete c;
+    }
+    return ok;
+}
+
+int main() {
+    const size_t GB = 1024ull * 1024 * 1024;
+
+    // ========== 1. 容量规划 ==========
+    std::cout << "=== 容量规划 ===" << std::endl;
+    ModelConfig opt125m{"OPT-125M", 12, 768, 12, 12, 3072, 50272};
+    ModelConfig llama7b{"Llama-7B", 32, 4096, 32, 32, 11008, 32000, 3};
+
+    std::vector<PlanInput> plans = {
+        {opt125m, DType::FP16, DType::FP16, 2048, 8 * GB, 16, 512ull * 1024 * 1024, 64ull * 1024 * 1024},
+        {llama7b, DType::FP16, DType::FP16, 4096, 24 * GB, 16, 1 * GB, 256ull * 1024 * 1024},
+        {llama7b, DType::INT4, DType::FP16, 4096, 24 * GB, 16, 1 * GB, 256ull * 1024 * 1024},
+        {llama7b, DType::INT4, DType::FP16, 16384, 24 * GB, 16, 1 * GB, 256ull * 1024 * 1024},
+    };
+    for (const auto& in : plans) print_plan(in, plan_capacity(in));
+
+    // ========== 2. 记账验证：SwiGLU 小模型，FP32 和 INT4 权重各一遍 ==========
+    ModelConfig tiny{"Tiny", 4, 256, 4, 4, 1024, 4096, 3};
+    bool ok = true;
+    for (DType t : {DType::FP32, DType::INT4}) {
+        std::cout << "\n=== 记账验证 (小模型 " << dtype_name(t) << ") ===" << std::endl;
+        PlanInput tiny_in{tiny, t, DType::FP32, 500, 64ull * 1024 * 1024, 16, 0, 4ull * 1024 * 1024};
+        ok = verify_plan(tiny_in) && ok;
+    }
+
+    MemoryTracker& tracker = MemoryTracker::instance();
+    const double MB = 1024.0 * 1024.0;
+
+    // ========== 3. 增长式 Cache：vector 按容量申请，实际占用高于元素数，规划器按预分配计不适用 ==========
+    std::cout << "\n=== 增长式 KV Cache ===" << std::endl;
+    {
+        RealKVCache growing;
+        growing.hidden_dim = tiny.hidden_dim;
+        std::vector<float> token_kv(tiny.hidden_dim, 0.1f);
+        for (int t = 0; t < 300; ++t) growing.append(token_kv.data(), token_kv.data());
+        size_t used = (growing.k.size() + growing.v.size()) * sizeof(float);
+        std::cout << "元素占用: " << used / MB << " MB | 实际申请: "
+                  << tracker.current_bytes(MemCategory::KVCache) / MB << " MB" << std::endl;
+    }
+
+    std::cout << "\n释放后:" << std::endl;
+    tracker.dump();
+    return ok ? 0 : 1;
+}
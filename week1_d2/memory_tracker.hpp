@@ -0,0 +1,161 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+
+// 内存记账：所有大块内存都走带分类的分配器，按类别统计当前值和峰值
+// STL 容器用 tracked_vector，原生缓冲区用 tracked_new / tracked_delete
+
+// ================= 内存分类 =================
+enum class MemCategory {
+    WeightsFP32,
+    WeightsFP16,
+    WeightsINT4,
+    KVCache,
+    Activations,
+    Arena,
+    Count
+};
+
+inline const char* category_name(MemCategory c) {
+    switch (c) {
+        case MemCategory::WeightsFP32: return "weights.fp32";
+        case MemCategory::WeightsFP16: return "weights.fp16";
+        case MemCategory::WeightsINT4: return "weights.int4";
+        case MemCategory::KVCache:     return "kv_cache";
+        case MemCategory::Activations: return "activations";
+        case MemCategory::Arena:       return "arena";
+        default:                       return "unknown";
+    }
+}
+
+// ================= 全局记账 =================
+struct MemoryTracker {
+    static constexpr int kNum = (int)MemCategory::Count;
+    std::atomic<size_t> current[kNum] = {};
+    std::atomic<size_t> peak[kNum] = {};
+    std::atomic<size_t> total_current{0};
+    std::atomic<size_t> total_peak{0};
+
+    static MemoryTracker& instance() {
+        static MemoryTracker tracker;
+        return tracker;
+    }
+
+    static void update_peak(std::atomic<size_t>& peak_val, size_t now) {
+        size_t old = peak_val.load(std::memory_order_relaxed);
+        while (now > old && !peak_val.compare_exchange_weak(old, now, std::memory_order_relaxed)) {}
+    }
+
+    void on_alloc(MemCategory c, size_t bytes) {
+        int i = (int)c;
+        size_t now = current[i].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        update_peak(peak[i], now);
+        size_t total = total_current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        update_peak(total_peak, total);
+    }
+
+    void on_free(MemCategory c, size_t bytes) {
+        current[(int)c].fetch_sub(bytes, std::memory_order_relaxed);
+        total_current.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    // 把峰值重置为当前值，分阶段统计时用
+    void reset_peak() {
+        for (int i = 0; i < kNum; ++i) peak[i].store(current[i].load());
+        total_peak.store(total_current.load());
+    }
+
+    size_t current_bytes(MemCategory c) const { return current[(int)c].load(); }
+    size_t peak_bytes(MemCategory c) const { return peak[(int)c].load(); }
+
+    void dump() const {
+        std::cout << "---------- 内存统计 (MB) ----------" << std::endl;
+        std::cout << std::left << std::setw(16) << "category" << std::right
+                  << std::setw(12) << "current" << std::setw(12) << "peak" << std::endl;
+        for (int i = 0; i < kNum; ++i) {
+            std::cout << std::left << std::setw(16) << category_name((MemCategory)i) << std::right
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(12) << current[i].load() / 1024.0 / 1024.0
+                      << std::setw(12) << peak[i].load() / 1024.0 / 1024.0 << std::endl;
+        }
+        std::cout << std::left << std::setw(16) << "total" << std::right
+                  << std::setw(12) << total_current.load() / 1024.0 / 1024.0
+                  << std::setw(12) << total_peak.load() / 1024.0 / 1024.0 << std::endl;
+    }
+};
+
+// ================= 带分类的分配器 =================
+// STL 容器用：std::vector<float, TrackedAllocator<float, MemCategory::KVCache>>
+template <typename T, MemCategory C>
+struct TrackedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = TrackedAllocator<U, C>; };
+
+    TrackedAllocator() = default;
+    template <typename U> TrackedAllocator(const TrackedAllocator<U, C>&) {}
+
+    T* allocate(size_t n) {
+        T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+        MemoryTracker::instance().on_alloc(C, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        MemoryTracker::instance().on_free(C, n * sizeof(T));
+        ::operator delete(p);
+    }
+
+    template <typename U> bool operator==(const TrackedAllocator<U, C>&) const { return true; }
+    template <typename U> bool operator!=(const TrackedAllocator<U, C>&) const { return false; }
+};
+
+template <typename T, MemCategory C>
+using tracked_vector = std::vector<T, TrackedAllocator<T, C>>;
+
+// 原生指针用（KVCacheOptimized 那种 new float[]）
+template <typename T>
+T* tracked_new(MemCategory c, size_t n) {
+    T* p = new T[n];
+    MemoryTracker::instance().on_alloc(c, n * sizeof(T));
+    return p;
+}
+
+template <typename T>
+void tracked_delete(MemCategory c, T* p, size_t n) {
+    MemoryTracker::instance().on_free(c, n * sizeof(T));
+    delete[] p;
+}
+
+// ================= Arena =================
+// Bump Arena：一次申请一大块，临时张量从里面切，整体 reset
+struct Arena {
+    uint8_t* base;
+    size_t capacity;
+    size_t offset = 0;
+    size_t high_water = 0;  // Arena 内部实际用到的最高位置
+
+    explicit Arena(size_t bytes) : capacity(bytes) {
+        base = tracked_new<uint8_t>(MemCategory::Arena, capacity);
+    }
+    ~Arena() { tracked_delete(MemCategory::Arena, base, capacity); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    float* alloc_floats(size_t n) {
+        size_t bytes = (n * sizeof(float) + 63) & ~size_t(63);  // 64 字节对齐
+        if (offset + bytes > capacity) throw std::bad_alloc();
+        float* p = reinterpret_cast<float*>(base + offset);
+        offset += bytes;
+        high_water = std::max(high_water, offset);
+        return p;
+    }
+
+    void reset() { offset = 0; }
+};
@@ -0,0 +1,409 @@
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <pthread.h>
+#include <sched.h>
+#include "real_kv_cache.hpp"
+
+// 长上下文序列并行 Attention：一条序列的 KV Cache 按位置区间切成多个分片
+// 1. 每个分片绑定一个 NUMA 节点，由绑在该节点上的线程自己申请并首次写入（first touch），物理页落在本地内存
+// 2. Decode 时每个分片在本地算部分 Attention：(max, sum_exp, 加权 V)
+// 3. 主线程做一次廉价合并，结果与单线程全量计算一致
+// 单节点机器上分片退化为线程组，逻辑完全相同，可以直接测试
+//
+// 编译: g++ -O3 -march=native -pthread numa_sharded_attention.cpp -o numa_sharded_attention
+
+// ================= NUMA 拓扑 =================
+// 读 /sys/devices/system/node 下的拓扑，不依赖 libnuma
+std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        size_t dash = range.find('-');
+        int lo = std::stoi(range.substr(0, dash));
+        int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+        for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+struct NumaNode {
+    int id;                 // 系统里的真实节点号，可能不连续
+    std::vector<int> cpus;  // 只含本进程允许运行的 CPU
+};
+
+// 本进程允许运行的 CPU（cpuset / 容器 / taskset 限制后的结果）
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &set)) cpus.push_back(c);
+        }
+    }
+    if (cpus.empty()) {
+        for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+// 节点号从 /sys/devices/system/node/online 读（可能有空洞，比如离线节点或无 CPU 的 CXL/HBM 节点）
+// 每个节点的 CPU 与允许集合取交集，交集为空的节点跳过；读不到就把允许的 CPU 当成一个节点
+std::vector<NumaNode> detect_numa_nodes() {
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<NumaNode> nodes;
+
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string online_list;
+    if (online && std::getline(online, online_list)) {
+        for (int id : parse_cpulist(online_list)) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string list;
+            if (!file || !std::getline(file, list)) continue;
+
+            NumaNode node{id, {}};
+            for (int c : parse_cpulist(list)) {
+                if (std::find(allowed.begin(), allowed.end(), c) != allowed.end()) node.cpus.push_back(c);
+            }
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+    }
+    if (nodes.empty()) nodes.push_back({0, allowed});
+    return nodes;
+}
+
+// 把当前线程绑到一组 CPU 上（绑节点而不是绑单核，节点内交给调度器）
+bool pin_current_thread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// ================= 分片 KV Cache =================
+// 部分 Attention 结果：softmax 的分子分母分开存，合并时按 max 重新缩放
+struct PartialAttention {
+    float max_score = -std::numeric_limits<float>::infinity();
+    float sum_exp = 0.0f;
+    std::vector<float> out;  // Σ exp(s_i - max) * v_i，未归一化
+};
+
+struct KVShard {
+    int node = 0;       // 真实 NUMA 节点号
+    int start_pos = 0;  // 负责的位置区间 [start_pos, start_pos + capacity)
+    int capacity = 0;
+    int len = 0;
+    float* k = nullptr; // (capacity, hidden_dim)，由分片线程申请并首次写入
+    float* v = nullptr;
+    std::vector<float> scores;
+    PartialAttention partial;
+    bool pinned = false;
+};
+
+// 按各节点可用 CPU 数成比例分配分片数，每个节点至少 1 个
+// 例：cpuset 在节点 0 上 2 个 CPU、节点 1 上 30 个，32 个分片 → 2 + 30，而不是 16 + 16
+std::vector<int> shards_per_node(const std::vector<NumaNode>& nodes, int num_shards) {
+    num_shards = std::max<int>(num_shards, nodes.size());
+    int total_cpus = 0;
+    for (const auto& node : nodes) total_cpus += node.cpus.size();
+
+    std::vector<int> counts(nodes.size());
+    int assigned = 0;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        counts[n] = std::max(1, (int)((long long)num_shards * nodes[n].cpus.size() / total_cpus));
+        assigned += counts[n];
+    }
+    // 取整后的差额：多了从「每分片 CPU 最少」的节点扣，少了补给「每分片 CPU 最多」的节点
+    auto cpus_per_shard = [&](size_t n) { return (double)nodes[n].cpus.size() / counts[n]; };
+    while (assigned < num_shards) {
+        size_t best = 0;
+        for (size_t n = 1; n < nodes.size(); ++n) {
+            if (cpus_per_shard(n) > cpus_per_shard(best)) best = n;
+        }
+        counts[best]++;
+        assigned++;
+    }
+    while (assigned > num_shards) {
+        int worst = -1;
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            if (counts[n] > 1 && (worst < 0 || cpus_per_shard(n) < cpus_per_shard(worst))) worst = n;
+        }
+        counts[worst]--;
+        assigned--;
+    }
+    return counts;
+}
+
+struct ShardedKVCache {
+    int hidden_dim;
+    int max_seq_len;
+    int seq_len = 0;
+    std::vector<KVShard> shards;
+    std::vector<std::thread> workers;
+
+    // 主线程与分片线程的同步：generation 每次 +1 表示一个新查询
+    std::mutex mu;
+    std::condition_variable job_cv;
+    std::condition_variable done_cv;
+    const float* current_q = nullptr;
+    int generation = 0;
+    int pending = 0;
+    bool stop = false;
+
+    // 分片按节点分组：同一节点的分片相邻，节点拿到一段连续的位置区间，长度与分片数成正比
+    ShardedKVCache(int max_len, int dim, int num_shards, const std::vector<NumaNode>& nodes)
+        : hidden_dim(dim), max_seq_len(max_len) {
+        std::vector<int> counts = shards_per_node(nodes, num_shards);
+        std::vector<const std::vector<int>*> shard_cpus;
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            for (int i = 0; i < counts[n]; ++i) {
+                KVShard shard;
+                shard.node = nodes[n].id;
+                shards.push_back(shard);
+                shard_cpus.push_back(&nodes[n].cpus);
+            }
+        }
+        num_shards = shards.size();
+
+        int per_shard = (max_len + num_shards - 1) / num_shards;
+        for (int s = 0; s < num_shards; ++s) {
+            shards[s].start_pos = s * per_shard;
+            shards[s].capacity = std::max(0, std::min(per_shard, max_len - s * per_shard));
+        }
+
+        // 等所有分片线程完成 pin + 申请 + first touch
+        pending = num_shards;
+        for (int s = 0; s < num_shards; ++s) {
+            workers.emplace_back(&ShardedKVCache::worker_loop, this, s, std::cref(*shard_cpus[s]));
+        }
+        std::unique_lock<std::mutex> lock(mu);
+        done_cv.wait(lock, [&] { return pending == 0; });
+    }
+
+    ~ShardedKVCache() {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        job_cv.notify_all();
+        for (auto& t : workers) t.join();
+        for (auto& shard : shards) {
+            tracked_delete(MemCategory::KVCache, shard.k, (size_t)shard.capacity * hidden_dim);
+            tracked_delete(MemCategory::KVCache, shard.v, (size_t)shard.capacity * hidden_dim);
+        }
+    }
+
+    ShardedKVCache(const ShardedKVCache&) = delete;
+    ShardedKVCache& operator=(const ShardedKVCache&) = delete;
+
+    void worker_loop(int s, const std::vector<int>& node_cpus) {
+        KVShard& shard = shards[s];
+        shard.pinned = pin_current_thread(node_cpus);
+
+        // first touch：在本节点线程里写一遍，物理页就分配在本节点内存上
+        size_t n = (size_t)shard.capacity * hidden_dim;
+        shard.k = tracked_new<float>(MemCategory::KVCache, n);
+        shard.v = tracked_new<float>(MemCategory::KVCache, n);
+        std::memset(shard.k, 0, n * sizeof(float));
+        std::memset(shard.v, 0, n * sizeof(float));
+        shard.scores.resize(shard.capacity);
+        shard.partial.out.resize(hidden_dim);
+
+        int seen = 0;
+        std::unique_lock<std::mutex> lock(mu);
+        if (--pending == 0) done_cv.notify_one();
+        while (true) {
+            job_cv.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+            const float* q = current_q;
+            lock.unlock();
+
+            compute_partial(shard, q);
+
+            lock.lock();
+            if (--pending == 0) done_cv.notify_one();
+        }
+    }
+
+    // 追加一个 Token；写入已 first touch 过的页，不会改变页的归属节点
+    void append(const float* new_k, const float* new_v) {
+        if (seq_len >= max_seq_len) return;
+        for (auto& shard : shards) {
+            if (seq_len < shard.start_pos + shard.capacity) {
+                std::memcpy(shard.k + (size_t)shard.len * hidden_dim, new_k, hidden_dim * sizeof(float));
+                std::memcpy(shard.v + (size_t)shard.len * hidden_dim, new_v, hidden_dim * sizeof(float));
+                shard.len++;
+                break;
+            }
+        }
+        seq_len++;
+    }
+
+    // 分片内的部分 Attention，只读本地 K/V
+    void compute_partial(KVShard& shard, const float* q) const {
+        PartialAttention& p = shard.partial;
+        p.max_score = -std::numeric_limits<float>::infinity();
+        p.sum_exp = 0.0f;
+        std::fill(p.out.begin(), p.out.end(), 0.0f);
+        if (shard.len == 0) return;
+
+        float scale = 1.0f / std::sqrt((float)hidden_dim);
+        for (int i = 0; i < shard.len; ++i) {
+            const float* k_row = shard.k + (size_t)i * hidden_dim;
+            float dot = 0.0f;
+            for (int d = 0; d < hidden_dim; ++d) dot += q[d] * k_row[d];
+            shard.scores[i] = dot * scale;
+            p.max_score = std::max(p.max_score, shard.scores[i]);
+        }
+
+        float* out = p.out.data();
+        for (int i = 0; i < shard.len; ++i) {
+            float w = expf(shard.scores[i] - p.max_score);
+            p.sum_exp += w;
+            const float* v_row = shard.v + (size_t)i * hidden_dim;
+            for (int d = 0; d < hidden_dim; ++d) out[d] += w * v_row[d];
+        }
+    }
+
+    // Decode 一步：各分片并行算部分结果，主线程合并
+    void attend(const float* q, float* out) {
+        // 空 Cache 没有可看的位置，直接输出 0，避免下面 0/0 得到 NaN
+        if (seq_len == 0) {
+            std::fill(out, out + hidden_dim, 0.0f);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            current_q = q;
+            pending = shards.size();
+            generation++;
+        }
+        job_cv.notify_all();
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            done_cv.wait(lock, [&] { return pending == 0; });
+        }
+
+        // 合并：全局 max 下重新缩放各分片的分子分母，只需 O(num_shards * hidden_dim)
+        float global_max = -std::numeric_limits<float>::infinity();
+        for (const auto& shard : shards) {
+            if (shard.len > 0) global_max = std::max(global_max, shard.partial.max_score);
+        }
+        float total = 0.0f;
+        std::fill(out, out + hidden_dim, 0.0f);
+        for (const auto& shard : shards) {
+            if (shard.len == 0) continue;
+            float factor = expf(shard.partial.max_score - global_max);
+            total += shard.partial.sum_exp * factor;
+            const float* o = shard.partial.out.data();
+            for (int d = 0; d < hidden_dim; ++d) out[d] += o[d] * factor;
+        }
+        for (int d = 0; d < hidden_dim; ++d) out[d] /= total;
+    }
+};
+
+int main() {
+    const int hidden_dim = 1024;
+    const int seq_len = 16384;   // 长上下文：单份 K/V 各 64 MB
+    const int decode_steps = 20;
+
+    auto nodes = detect_numa_nodes();
+    // 分片数按本进程允许的 CPU 数定，不按整机 CPU 数；至少 2 个，保证单核也能走到合并逻辑
+    int total_cpus = 0;
+    for (const auto& node : nodes) total_cpus += node.cpus.size();
+    int num_shards = std::max(2, total_cpus);
+
+    std::cout << "=== NUMA 分片 Attention ===" << std::endl;
+    std::cout << "NUMA 节点:";
+    for (const auto& node : nodes) std::cout << " " << node.id << "(" << node.cpus.size() << " CPU)";
+    std::cout << " | 可用 CPU: " << total_cpus
+              << " | 分片数: " << num_shards << " | 序列长度: " << seq_len << std::endl;
+
+    RealKVCache reference;
+    reference.hidden_dim = hidden_dim;
+    ShardedKVCache sharded(seq_len, hidden_dim, num_shards, nodes);
+    // 每个节点的分片数和负责的位置区间，应与可用 CPU 数成比例且连续
+    for (const auto& node : nodes) {
+        int count = 0, begin = seq_len, end = 0;
+        for (const auto& shard : sharded.shards) {
+            if (shard.node != node.id) continue;
+            count++;
+            begin = std::min(begin, shard.start_pos);
+            end = std::max(end, shard.start_pos + shard.capacity);
+        }
+        std::cout << "  节点 " << node.id << ": " << node.cpus.size() << " CPU | " << count << " 个分片 | 位置 ["
+                  << begin << ", " << end << ") | 占 " << 100.0 * (end - begin) / seq_len << "%" << std::endl;
+    }
+    for (size_t s = 0; s < sharded.shards.size(); ++s) {
+        const KVShard& shard = sharded.shards[s];
+        std::cout << "  分片 " << s << ": 节点 " << shard.node << " | 位置 [" << shard.start_pos << ", "
+                  << shard.start_pos + shard.capacity << ") | " << (shard.pinned ? "已绑核" : "绑核失败") << std::endl;
+    }
+
+    // 填充整条上下文（模拟 Prefill 之后的 Cache）
+    std::vector<float> new_k(hidden_dim), new_v(hidden_dim);
+    for (int t = 0; t < seq_len; ++t) {
+        for (int d = 0; d < hidden_dim; ++d) {
+            new_k[d] = sinf(0.001f * t + 0.01f * d);
+            new_v[d] = cosf(0.002f * t - 0.01f * d);
+        }
+        reference.append(new_k.data(), new_v.data());
+        sharded.append(new_k.data(), new_v.data());
+    }
+
+    std::vector<std::vector<float>> queries(decode_steps, std::vector<float>(hidden_dim));
+    for (int i = 0; i < decode_steps; ++i) {
+        for (int d = 0; d < hidden_dim; ++d) queries[i][d] = sinf(0.3f * i + 0.05f * d);
+    }
+
+    // ========== 单线程：整条 Cache 一个核读 ==========
+    std::vector<std::vector<float>> ref_out(decode_steps, std::vector<float>(hidden_dim));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < decode_steps; ++i) reference.attend(queries[i].data(), reference.seq_len(), ref_out[i].data());
+    auto single_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    // ========== 分片：各节点并行读本地分片 ==========
+    std::vector<std::vector<float>> shard_out(decode_steps, std::vector<float>(hidden_dim));
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < decode_steps; ++i) sharded.attend(queries[i].data(), shard_out[i].data());
+    auto sharded_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    float max_error = 0.0f;
+    for (int i = 0; i < decode_steps; ++i) {
+        for (int d = 0; d < hidden_dim; ++d) {
+            max_error = std::max(max_error, std::abs(ref_out[i][d] - shard_out[i][d]));
+        }
+    }
+
+    std::cout << "单线程 Attention: " << single_time << " ms" << std::endl;
+    std::cout << "分片 Attention:   " << sharded_time << " ms" << std::endl;
+    std::cout << "速度提升:         " << (double)single_time / std::max<long long>(sharded_time, 1) << " 倍" << std::endl;
+    std::cout << "最大误差:         " << max_error << std::endl;
+    // kv_cache 一栏 = 单线程对照的一份 + 各分片的一份
+    MemoryTracker::instance().dump();
+
+    if (max_error < 1e-4f) {
+        std::cout << "✅ 分片合并结果与单线程一致" << std::endl;
+    } else {
+        std::cout << "❌ 分片合并结果不一致！" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <chrono>
 #include <cstring>
+#include "real_kv_cache.hpp"
 
 // 矩阵乘法 (M, K) × (K, N) = (M, N)
 void matmul(const float* A, const float* B, float* C, int M, int K, int N) {
@@ -30,49 +31,38 @@ void softmax(float* x, int size) {
     for (int i = 0; i < size; ++i) x[i] /= sum;
 }
 
-// 缓存结构
-struct RealKVCache {
-    std::vector<float> k;  // (seq_len, hidden_dim)
-    std::vector<float> v;  // (seq_len, hidden_dim)
-    int hidden_dim = 768;
+// 计算 Attention (有 Cache)
+float compute_with_cache(const RealKVCache& cache, const float* q) {
+    int hidden_dim = cache.hidden_dim;
+    int seq_len = cache.seq_len();
+    std::vector<float> scores(seq_len);
     
-    void append(const float* new_k, const float* new_v) {
-        k.insert(k.end(), new_k, new_k + hidden_dim);
-        v.insert(v.end(), new_v, new_v + hidden_dim);
-    }
+    // Q × K^T (1, hidden_dim) × (hidden_dim, seq_len) = (1, seq_len)
+    matmul(q, cache.k.data(), scores.data(), 1, hidden_dim, seq_len);
     
-    // 计算 Attention (有 Cache)
-    float compute_with_cache(const float* q) {
-        int seq_len = k.size() / hidden_dim;
-        std::vector<float> scores(seq_len);
-        
-        // Q × K^T (1, hidden_dim) × (hidden_dim, seq_len) = (1, seq_len)
-        matmul(q, k.data(), scores.data(), 1, hidden_dim, seq_len);
-        
-        // Softmax
-        softmax(scores.data(), seq_len);
-        
-        // 加权求和 (1, seq_len) × (seq_len, hidden_dim) = (1, hidden_dim)
-        float result = 0.0f;
-        for (int i = 0; i < seq_len; ++i) {
-            result += scores[i] * v[i * hidden_dim];  // 简化版
-        }
-        return result;
+    // Softmax
+    softmax(scores.data(), seq_len);
+    
+    // 加权求和 (1, seq_len) × (seq_len, hidden_dim) = (1, hidden_dim)
+    float result = 0.0f;
+    for (int i = 0; i < seq_len; ++i) {
+        result += scores[i] * cache.v[i * hidden_dim];  // 简化版
     }
+    return result;
+}
+
+// 无 Cache：每次都从头计算
+float compute_without_cache(const float* q, const float* all_k, const float* all_v, int seq_len, int hidden_dim) {
+    std::vector<float> scores(seq_len);
+    matmul(q, all_k, scores.data(), 1, hidden_dim, seq_len);
+    softmax(scores.data(), seq_len);
     
-    // 无 Cache：每次都从头计算
-    float compute_without_cache(const float* q, const float* all_k, const float* all_v, int seq_len) {
-        std::vector<float> scores(seq_len);
-        matmul(q, all_k, scores.data(), 1, hidden_dim, seq_len);
-        softmax(scores.data(), seq_len);
-        
-        float result = 0.0f;
-        for (int i = 0; i < seq_len; ++i) {
-            result += scores[i] * all_v[i * hidden_dim];
-        }
-        return result;
+    float result = 0.0f;
+    for (int i = 0; i < seq_len; ++i) {
+        result += scores[i] * all_v[i * hidden_dim];
     }
-};
+    return result;
+}
 
 int main() {
     // 加载权重 (模拟)
@@ -97,7 +87,7 @@ int main() {
         matmul(hidden, v_proj.data(), new_v, 1, 768, 768);
         
         cache.append(new_k, new_v);
-        float output = cache.compute_with_cache(q);
+        float output = compute_with_cache(cache, q);
     }
     auto end = std::chrono::high_resolution_clock::now();
     auto cache_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
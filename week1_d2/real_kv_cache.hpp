@@ -0,0 +1,56 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "memory_tracker.hpp"
+
+// 增长式 KV Cache（单头，hidden_dim 维），K/V 记在 kv_cache 类别下
+struct RealKVCache {
+    tracked_vector<float, MemCategory::KVCache> k;  // 展平: (seq_len, hidden_dim)
+    tracked_vector<float, MemCategory::KVCache> v;  // 展平: (seq_len, hidden_dim)
+    int hidden_dim = 768;
+
+    int seq_len() const { return k.size() / hidden_dim; }
+
+    void append(const float* new_k, const float* new_v) {
+        k.insert(k.end(), new_k, new_k + hidden_dim);
+        v.insert(v.end(), new_v, new_v + hidden_dim);
+    }
+
+    // 回滚到 new_len 个 Token，负数按 0 处理
+    // resize 变小不会释放容量，下次 append 不会 realloc
+    void truncate(int new_len) {
+        new_len = std::max(0, new_len);
+        if (new_len >= seq_len()) return;
+        k.resize((size_t)new_len * hidden_dim);
+        v.resize((size_t)new_len * hidden_dim);
+    }
+
+    // 因果 Attention：q 只能看到前 visible_len 个位置，结果写入 out (hidden_dim)
+    void attend(const float* q, int visible_len, float* out) const {
+        std::vector<float> scores(visible_len);
+        float scale = 1.0f / std::sqrt((float)hidden_dim);
+        float max_score = -INFINITY;
+        for (int i = 0; i < visible_len; ++i) {
+            const float* k_row = k.data() + (size_t)i * hidden_dim;
+            float dot = 0.0f;
+            for (int d = 0; d < hidden_dim; ++d) dot += q[d] * k_row[d];
+            scores[i] = dot * scale;
+            max_score = std::max(max_score, scores[i]);
+        }
+
+        // Softmax
+        float sum = 0.0f;
+        for (int i = 0; i < visible_len; ++i) {
+            scores[i] = expf(scores[i] - max_score);
+            sum += scores[i];
+        }
+
+        std::fill(out, out + hidden_dim, 0.0f);
+        for (int i = 0; i < visible_len; ++i) {
+            float w = scores[i] / sum;
+            const float* v_row = v.data() + (size_t)i * hidden_dim;
+            for (int d = 0; d < hidden_dim; ++d) out[d] += w * v_row[d];
+        }
+    }
+};
@@ -0,0 +1,285 @@
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include "real_kv_cache.hpp"
+
+// 自投机解码 (Self-Speculative Decoding)
+// 草稿模型 = 同一个模型的前几层 + LM Head（Early Exit），不需要第二份权重文件
+// 1. 草稿：只跑前 draft_layers 层，连续猜 k 个 Token
+// 2. 验证：完整模型一次批量前向处理 k+1 个 Token，复用浅层结果只补跑深层
+// 3. 回滚：被拒绝的 Token 对应的 KV Cache 直接截断
+//
+// 保证：只对贪心解码成立——输出与逐 Token 解码逐位一致。没有拒绝采样，随机采样时不保证分布一致
+// 实测（单核，12 层 / hidden 1024 / vocab 4096，随机权重下接受率约 80%）：
+//   g++ -O3 -march=native: 1.2x ~ 1.5x；g++ -O2: 0.8x ~ 0.9x（比逐 Token 更慢）
+// 低于 1.5x ~ 2.5x 的目标：下面的 matmul 受 L1 / 计算限制而不是带宽限制，k+1 个 Token 的验证
+// 大约要花 k+1 倍的计算；每个草稿 Token 还要跑一遍完整的 LM Head（约等于一层 Decoder 的开销）
+// 加速比 < 1 时 main 返回 1
+//
+// 编译: g++ -O3 -march=native speculative_decoding.cpp -o speculative_decoding
+
+// 矩阵乘法 (M, K) × (K, N) = (M, N)
+// B 按行顺序流式读取，每次取 4 行给全部 M 行输入共用，权重只从内存读一遍；
+// 但内层对 C 的读写和乘加仍是 M 倍，CPU 上 M = k+1 时耗时约随 M 线性增长
+void matmul(const float* A, const float* B, float* C, int M, int K, int N) {
+    std::fill(C, C + M * N, 0.0f);
+    int k = 0;
+    for (; k + 4 <= K; k += 4) {
+        const float* b0 = B + k * N;
+        const float* b1 = b0 + N;
+        const float* b2 = b1 + N;
+        const float* b3 = b2 + N;
+        for (int i = 0; i < M; ++i) {
+            const float* a = A + i * K + k;
+            float* c = C + i * N;
+            for (int j = 0; j < N; ++j) {
+                c[j] += a[0] * b0[j] + a[1] * b1[j] + a[2] * b2[j] + a[3] * b3[j];
+            }
+        }
+    }
+    for (; k < K; ++k) {
+        const float* b = B + k * N;
+        for (int i = 0; i < M; ++i) {
+            float a = A[i * K + k];
+            float* c = C + i * N;
+            for (int j = 0; j < N; ++j) c[j] += a * b[j];
+        }
+    }
+}
+
+int argmax(const float* x, int size) {
+    return std::max_element(x, x + size) - x;
+}
+
+using Weights = tracked_vector<float, MemCategory::WeightsFP32>;
+
+struct DecoderLayer {
+    Weights q_proj, k_proj, v_proj, o_proj;  // 各 (hidden_dim, hidden_dim)
+};
+
+// 简化 Decoder：Embedding → N × (Attention + 残差) → LM Head
+struct TinyModel {
+    int hidden_dim;
+    int vocab_size;
+    Weights embedding;  // (vocab_size, hidden_dim)
+    Weights lm_head;    // (hidden_dim, vocab_size)
+    std::vector<DecoderLayer> layers;
+    std::vector<RealKVCache> caches;  // 每层一个
+
+    TinyModel(int num_layers, int dim, int vocab) : hidden_dim(dim), vocab_size(vocab) {
+        // 实际应从 .npy 文件加载，这里填充随机值
+        auto fill = [](Weights& w, size_t n, float range) {
+            w.resize(n);
+            for (auto& x : w) x = ((rand() % 1000) / 1000.0f - 0.5f) * range;
+        };
+        fill(embedding, (size_t)vocab * dim, 2.0f);
+        fill(lm_head, (size_t)dim * vocab, 2.0f);
+
+        layers.resize(num_layers);
+        caches.resize(num_layers);
+        for (int l = 0; l < num_layers; ++l) {
+            fill(layers[l].q_proj, (size_t)dim * dim, 0.2f);
+            fill(layers[l].k_proj, (size_t)dim * dim, 0.2f);
+            fill(layers[l].v_proj, (size_t)dim * dim, 0.2f);
+            // 残差分支较小：浅层的预测和深层大体一致，这正是 Early Exit 能当草稿的原因
+            fill(layers[l].o_proj, (size_t)dim * dim, 0.003f);
+            caches[l].hidden_dim = dim;
+        }
+    }
+
+    int num_layers() const { return layers.size(); }
+
+    // 已确认的 Token 数（以最深层为准，草稿阶段浅层 Cache 会比深层长）
+    int seq_len() const { return caches.back().seq_len(); }
+
+    void truncate(int new_len) {
+        for (auto& cache : caches) cache.truncate(new_len);
+    }
+
+    void embed(const int* tokens, int T, std::vector<float>& h) const {
+        h.resize((size_t)T * hidden_dim);
+        for (int t = 0; t < T; ++t) {
+            std::memcpy(h.data() + t * hidden_dim, embedding.data() + (size_t)tokens[t] * hidden_dim,
+                        hidden_dim * sizeof(float));
+        }
+    }
+
+    // 批量跑第 [first, last) 层：T 个 Token 接在各层 Cache 后面，h 原地更新
+    void run_layers(std::vector<float>& h, int T, int first, int last) {
+        std::vector<float> q(T * hidden_dim), k(T * hidden_dim), v(T * hidden_dim);
+        std::vector<float> attn(T * hidden_dim), out(T * hidden_dim);
+        for (int l = first; l < last; ++l) {
+            const DecoderLayer& layer = layers[l];
+            RealKVCache& cache = caches[l];
+            int base = cache.seq_len();
+
+            // Q/K/V: (T, hidden_dim) × (hidden_dim, hidden_dim)
+            matmul(h.data(), layer.q_proj.data(), q.data(), T, hidden_dim, hidden_dim);
+            matmul(h.data(), layer.k_proj.data(), k.data(), T, hidden_dim, hidden_dim);
+            matmul(h.data(), layer.v_proj.data(), v.data(), T, hidden_dim, hidden_dim);
+
+            for (int t = 0; t < T; ++t) {
+                cache.append(k.data() + t * hidden_dim, v.data() + t * hidden_dim);
+            }
+            // 第 t 个 Token 只能看到自己及之前的位置
+            for (int t = 0; t < T; ++t) {
+                cache.attend(q.data() + t * hidden_dim, base + t + 1, attn.data() + t * hidden_dim);
+            }
+
+            matmul(attn.data(), layer.o_proj.data(), out.data(), T, hidden_dim, hidden_dim);
+            for (int i = 0; i < T * hidden_dim; ++i) h[i] += out[i];
+        }
+    }
+
+    // logits: (T, vocab_size)，第 t 行预测第 t 个 Token 的下一个 Token
+    void head(const std::vector<float>& h, int T, std::vector<float>& logits) const {
+        logits.resize((size_t)T * vocab_size);
+        matmul(h.data(), lm_head.data(), logits.data(), T, hidden_dim, vocab_size);
+    }
+
+    void forward(const int* tokens, int T, std::vector<float>& logits) {
+        std::vector<float> h;
+        embed(tokens, T, h);
+        run_layers(h, T, 0, num_layers());
+        head(h, T, logits);
+    }
+};
+
+// 基线：每个 Token 跑一次完整前向
+std::vector<int> generate_greedy(TinyModel& model, const std::vector<int>& prompt, int max_new_tokens) {
+    std::vector<float> logits;
+    std::vector<int> output;
+
+    model.forward(prompt.data(), prompt.size(), logits);
+    int next = argmax(logits.data() + (prompt.size() - 1) * model.vocab_size, model.vocab_size);
+    output.push_back(next);
+
+    while ((int)output.size() < max_new_tokens) {
+        model.forward(&next, 1, logits);
+        next = argmax(logits.data(), model.vocab_size);
+        output.push_back(next);
+    }
+    return output;
+}
+
+struct SpecStats {
+    int rounds = 0;
+    int drafted = 0;
+    int accepted = 0;
+};
+
+// 自投机解码：前 draft_layers 层起草 k 个 Token，完整模型一次验证
+// 浅层对草稿 Token 的计算和完整模型完全相同，验证时直接复用浅层 Cache 和隐状态，只补跑深层
+std::vector<int> generate_speculative(TinyModel& model, const std::vector<int>& prompt, int max_new_tokens,
+                                      int draft_layers, int k, SpecStats& stats) {
+    const int hidden_dim = model.hidden_dim;
+    std::vector<float> logits;
+    std::vector<int> output;
+
+    model.forward(prompt.data(), prompt.size(), logits);
+    int next = argmax(logits.data() + (prompt.size() - 1) * model.vocab_size, model.vocab_size);
+    output.push_back(next);
+
+    std::vector<int> verify_tokens(k + 1);
+    std::vector<float> verify_hidden((k + 1) * hidden_dim);  // 各 Token 在第 draft_layers 层出口的隐状态
+    std::vector<float> h;
+    while ((int)output.size() < max_new_tokens) {
+        // next 还没进 Cache，committed 之前的位置都已被完整模型确认
+        int committed = model.seq_len();
+
+        // 1. 草稿：只跑浅层 + LM Head，逐个猜 k 个 Token
+        verify_tokens[0] = next;
+        for (int i = 0; i <= k; ++i) {
+            model.embed(&verify_tokens[i], 1, h);
+            model.run_layers(h, 1, 0, draft_layers);
+            std::memcpy(verify_hidden.data() + i * hidden_dim, h.data(), hidden_dim * sizeof(float));
+            // 最后一个草稿只需要浅层 K/V 和隐状态，不用再猜
+            if (i == k) break;
+            model.head(h, 1, logits);
+            verify_tokens[i + 1] = argmax(logits.data(), model.vocab_size);
+        }
+
+        // 2. 验证：从第 draft_layers 层接着跑，k+1 个 Token 一次批量过完深层
+        model.run_layers(verify_hidden, k + 1, draft_layers, model.num_layers());
+        model.head(verify_hidden, k + 1, logits);
+
+        // 第 i 行 logits 预测 verify_tokens[i] 之后的 Token
+        int accepted = 0;
+        while (accepted < k &&
+               argmax(logits.data() + accepted * model.vocab_size, model.vocab_size) == verify_tokens[accepted + 1]) {
+            output.push_back(verify_tokens[accepted + 1]);
+            ++accepted;
+        }
+        // 第一个不一致的位置（或全部接受后的下一个位置）由完整模型直接给出
+        next = argmax(logits.data() + accepted * model.vocab_size, model.vocab_size);
+        output.push_back(next);
+
+        // 3. 回滚：所有层只保留 next 和被接受的草稿
+        model.truncate(committed + 1 + accepted);
+
+        stats.rounds++;
+        stats.drafted += k;
+        stats.accepted += accepted;
+    }
+
+    output.resize(max_new_tokens);
+    return output;
+}
+
+int main() {
+    const int num_layers = 12;
+    const int hidden_dim = 1024;
+    const int vocab_size = 4096;
+    const int draft_layers = 3;   // 草稿只用前 3 层
+    const int k = 4;              // 每轮猜 4 个 Token
+    const int max_new_tokens = 64;
+
+    srand(42);
+    TinyModel model(num_layers, hidden_dim, vocab_size);
+    std::vector<int> prompt = {1, 17, 256, 1024, 7};
+
+    std::cout << "=== 自投机解码 (Early Exit 草稿) ===" << std::endl;
+    std::cout << "层数: " << num_layers << " | 草稿层数: " << draft_layers << " | k = " << k << std::endl;
+
+    // ========== 基线：逐 Token 解码 ==========
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<int> baseline = generate_greedy(model, prompt, max_new_tokens);
+    auto baseline_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    // ========== 自投机解码 ==========
+    model.truncate(0);
+    SpecStats stats;
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<int> speculative = generate_speculative(model, prompt, max_new_tokens, draft_layers, k, stats);
+    auto spec_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    // ========== 结果对比 ==========
+    std::cout << "逐 Token 解码: " << baseline_time << " ms" << std::endl;
+    std::cout << "自投机解码:    " << spec_time << " ms" << std::endl;
+    double speedup = (double)baseline_time / std::max<long long>(spec_time, 1);
+    std::cout << "速度提升:      " << speedup << " 倍" << std::endl;
+    std::cout << "草稿接受率:    " << 100.0 * stats.accepted / std::max(stats.drafted, 1) << "% ("
+              << stats.accepted << "/" << stats.drafted << ")" << std::endl;
+    std::cout << "平均每轮产出:  " << (double)(max_new_tokens - 1) / std::max(stats.rounds, 1) << " 个 Token" << std::endl;
+
+    MemoryTracker::instance().dump();
+
+    if (baseline == speculative) {
+        std::cout << "✅ 输出与逐 Token 解码完全一致" << std::endl;
+    } else {
+        std::cout << "❌ 输出不一致！" << std::endl;
+        return 1;
+    }
+
+    if (speedup < 1.0) {
+        std::cout << "❌ 自投机解码比逐 Token 解码更慢！" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}